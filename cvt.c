@@ -0,0 +1,495 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <sys/param.h>
+
+// Native ecvt(), fcvt() and gcvt().
+//
+// Lotus formats every number it displays with these, so a full screen of
+// numbers in Fixed or Comma format calls them thousands of times on every
+// repaint. Glibc implements them with printf(), which is exact but slow.
+//
+// A double is m * 2^e, with a 53 bit m. Rounding it to a fixed number of
+// decimal places is just round(m * 2^e * 10^f), and for the range of numbers
+// people actually put in spreadsheets we can do that exactly with 128 bit
+// integer arithmetic. The rounding is to nearest with ties to even, the same
+// as printf(). Anything outside that range, and the odd cases where glibc
+// does something unusual, are passed to glibc so the results are always
+// identical.
+//
+// The results are also remembered, because most cells are repainted with the
+// same value many times.
+
+// The most significant digits ecvt() and gcvt() will produce.
+#define MAX_DIGITS 17
+
+// The most digits we handle ourselves, so that they fit in a uint64_t.
+#define MAX_FIXED_DIGITS 19
+
+#define CACHE_SIZE 1024
+#define MAX_CACHED_LEN 31
+
+enum {
+    CONVERTED_ECVT = 1,
+    CONVERTED_FCVT,
+    CONVERTED_GCVT,
+};
+
+struct CONVERTED {
+    uint64_t bits;
+    uint8_t kind;               // CONVERTED_ECVT etc, 0 if unused.
+    int8_t ndigit;
+    int16_t decpt;
+    uint8_t sign;
+    char str[MAX_CACHED_LEN + 1];
+};
+
+struct U128 {
+    uint64_t high;
+    uint64_t low;
+};
+
+static const uint64_t powers[] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+// Powers of ten that are exactly representable as doubles.
+#define MAX_EXACT_POWER 22
+
+static const double exact_powers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static struct CONVERTED cache[CACHE_SIZE];
+
+// The results of ecvt() and fcvt() are static, like the originals.
+static char ecvt_buffer[MAX_CACHED_LEN + 1];
+static char fcvt_buffer[MAX_CACHED_LEN + 1];
+
+// We can't use __int128 in a 32 bit build.
+static struct U128 multiply(uint64_t a, uint64_t b)
+{
+    uint64_t a0 = (uint32_t) a, a1 = a >> 32;
+    uint64_t b0 = (uint32_t) b, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t middle = (p00 >> 32) + (uint32_t) p01 + (uint32_t) p10;
+    struct U128 result;
+
+    result.low = (middle << 32) | (uint32_t) p00;
+    result.high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+    return result;
+}
+
+// Split x into the remainder below bit shift, and the quotient.
+static void shift_right(struct U128 x, int shift, struct U128 *quotient, struct U128 *remainder)
+{
+    if (shift < 64) {
+        quotient->high = x.high >> shift;
+        quotient->low = (x.low >> shift) | (shift ? x.high << (64 - shift) : 0);
+        remainder->high = 0;
+        remainder->low = shift ? x.low & ((1ULL << shift) - 1) : 0;
+    } else {
+        quotient->high = 0;
+        quotient->low = shift == 64 ? x.high : x.high >> (shift - 64);
+        remainder->high = shift == 64 ? 0 : x.high & ((1ULL << (shift - 64)) - 1);
+        remainder->low = x.low;
+    }
+}
+
+// Compare a remainder with half of 2^shift.
+static int compare_half(struct U128 remainder, int shift)
+{
+    struct U128 half = {0};
+
+    if (shift - 1 < 64) {
+        half.low = 1ULL << (shift - 1);
+    } else {
+        half.high = 1ULL << (shift - 65);
+    }
+
+    if (remainder.high != half.high)
+        return remainder.high < half.high ? -1 : 1;
+    if (remainder.low != half.low)
+        return remainder.low < half.low ? -1 : 1;
+    return 0;
+}
+
+// Work out floor(|value| * 10^f) exactly, and whether rounding it to nearest
+// even would round up. Returns false if it won't fit, or needs more than 128
+// bits to work out.
+static bool scale(double value, int f, uint64_t *quotient, bool *roundup)
+{
+    uint64_t bits, m;
+    int e;
+
+    memcpy(&bits, &value, sizeof bits);
+
+    m = bits & ((1ULL << 52) - 1);
+    e = (bits >> 52) & 0x7ff;
+
+    if (e == 0) {
+        e = -1074;
+    } else {
+        m |= 1ULL << 52;
+        e -= 1075;
+    }
+
+    if (m == 0)
+        return false;
+
+    // Make the exponent as small as possible.
+    while (e < 0 && (m & 1) == 0) {
+        m >>= 1;
+        e++;
+    }
+
+    if (f >= 0) {
+        struct U128 product, q, r;
+        int cmp;
+
+        if (f > MAX_FIXED_DIGITS)
+            return false;
+
+        product = multiply(m, powers[f]);
+
+        if (e >= 0) {
+            if (product.high || e >= 64 || (e && product.low >> (64 - e)))
+                return false;
+
+            *quotient = product.low << e;
+            *roundup = false;
+            return true;
+        }
+
+        if (-e > 127)
+            return false;
+
+        shift_right(product, -e, &q, &r);
+
+        if (q.high)
+            return false;
+
+        cmp = compare_half(r, -e);
+
+        *quotient = q.low;
+        *roundup = cmp > 0 || (cmp == 0 && (q.low & 1));
+        return true;
+    } else {
+        uint64_t divisor, x, r;
+
+        if (-f > MAX_FIXED_DIGITS)
+            return false;
+
+        divisor = powers[-f];
+
+        if (e >= 0) {
+            if (e >= 64 || m > UINT64_MAX >> e)
+                return false;
+            x = m << e;
+        } else {
+            if (-e >= 64 || divisor > UINT64_MAX >> -e)
+                return false;
+            x = m;
+            divisor <<= -e;
+        }
+
+        *quotient = x / divisor;
+        r = x % divisor;
+
+        // Compare the remainder with half the divisor, without overflowing.
+        *roundup = r > divisor - r || (r == divisor - r && (*quotient & 1));
+        return true;
+    }
+}
+
+// Round |value| to ndigit significant digits exactly, like printf() does,
+// and find the position of the decimal point. Returns false if we can't.
+static bool significant_digits(double value, int ndigit, uint64_t *digits, int *decpt)
+{
+    int k = floor(log10(fabs(value)));
+    uint64_t quotient;
+    bool roundup;
+
+    // The estimate of the exponent might be out by one either way.
+    for (int tries = 0; ; tries++) {
+        if (tries == 3 || !scale(value, ndigit - 1 - k, &quotient, &roundup))
+            return false;
+
+        if (quotient < powers[ndigit - 1]) {
+            k--;
+        } else if (quotient >= powers[ndigit]) {
+            k++;
+        } else {
+            break;
+        }
+    }
+
+    *digits = quotient + roundup;
+    *decpt = k + 1;
+    // This rounded up to the next power of ten.
+    if (*digits == powers[ndigit]) {
+        *digits /= 10;
+        *decpt += 1;
+    }
+
+    return true;
+}
+
+// Write the digits of a number, at least mindigits of them.
+static int format_digits(char *str, uint64_t number, int mindigits)
+{
+    char digits[MAX_FIXED_DIGITS + 1];
+    int len = 0;
+
+    do {
+        digits[len++] = '0' + number % 10;
+        number /= 10;
+    } while (number || len < mindigits);
+
+    for (int i = 0; i < len; i++) {
+        str[i] = digits[len - 1 - i];
+    }
+
+    str[len] = '\0';
+    return len;
+}
+
+static struct CONVERTED *find_converted(int kind, double value, int ndigit)
+{
+    uint64_t bits, hash;
+
+    memcpy(&bits, &value, sizeof bits);
+
+    hash = (bits ^ (bits >> 29) ^ ((uint64_t) ndigit << 7) ^ kind) * 0x9e3779b97f4a7c15ULL;
+
+    return &cache[(hash >> 32) % CACHE_SIZE];
+}
+
+static bool is_converted(const struct CONVERTED *converted, int kind, double value, int ndigit)
+{
+    return converted->kind == kind
+        && converted->ndigit == ndigit
+        && memcmp(&converted->bits, &value, sizeof value) == 0;
+}
+
+static void remember(struct CONVERTED *converted,
+                     int kind,
+                     double value,
+                     int ndigit,
+                     const char *str,
+                     int decpt,
+                     int sign)
+{
+    if (strlen(str) > MAX_CACHED_LEN || ndigit < INT8_MIN || ndigit > INT8_MAX)
+        return;
+
+    memcpy(&converted->bits, &value, sizeof value);
+    converted->kind = kind;
+    converted->ndigit = ndigit;
+    converted->decpt = decpt;
+    converted->sign = sign;
+    strcpy(converted->str, str);
+}
+
+// Round |value| to ndigit decimal places, like fcvt(). Returns false if we
+// can't do it exactly, or it rounds to zero.
+static bool fixed_digits(double value, int ndigit, char *str, int *decpt)
+{
+    uint64_t quotient;
+    bool roundup;
+
+    if (!scale(value, ndigit, &quotient, &roundup))
+        return false;
+
+    if (quotient + roundup == 0 || quotient >= powers[MAX_FIXED_DIGITS])
+        return false;
+
+    *decpt = format_digits(str, quotient + roundup, 1) - ndigit;
+    return true;
+}
+
+// Find the power of ten glibc's ecvt() scales by, the same way it does. It
+// doesn't use log10(), it multiplies |value| by 10, 100, 1000 and so on until
+// the rounded product is at least 1, or compares it with increasing powers of
+// ten if it's 10 or more. Returns false if that needs a power of ten that
+// isn't exact.
+static bool ecvt_exponent(double value, int *k)
+{
+    double d = fabs(value);
+    int j;
+
+    if (d < 1) {
+        for (j = 1; j <= MAX_EXACT_POWER; j++) {
+            if (d * exact_powers[j] >= 1) {
+                *k = -j;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    for (j = 0; j < MAX_EXACT_POWER; j++) {
+        if (d < exact_powers[j + 1]) {
+            *k = j;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Glibc doesn't round the exact value here. It scales it by a power of ten to
+// get one digit before the point, then rounds that like fcvt(). We do the
+// same, because we want the same results. The power of ten is exact, so the
+// scaling is only rounded once.
+//
+// If the scaled value rounds up to 10, fcvt() gives a digit more than was
+// asked for, e.g. ecvt(9.9999999999999991e-05, 4) is "10000" with decpt -3.
+// That's what glibc returns, so we don't fix it.
+char * __unix_ecvt(double value, int ndigit, int *decpt, int *sign)
+{
+    struct CONVERTED *converted = find_converted(CONVERTED_ECVT, value, ndigit);
+    char *result;
+    int k;
+
+    if (is_converted(converted, CONVERTED_ECVT, value, ndigit)) {
+        *decpt = converted->decpt;
+        *sign = converted->sign;
+        return strcpy(ecvt_buffer, converted->str);
+    }
+
+    if (isfinite(value)
+     && value != 0
+     && ndigit > 0
+     && ndigit <= MAX_DIGITS
+     && ecvt_exponent(value, &k)
+     && fixed_digits(k < 0 ? value * exact_powers[-k] : value / exact_powers[k],
+                     ndigit - 1,
+                     ecvt_buffer,
+                     decpt)) {
+        *decpt += k;
+        *sign = signbit(value) != 0;
+        result = ecvt_buffer;
+    } else {
+        result = ecvt(value, ndigit, decpt, sign);
+    }
+
+    remember(converted, CONVERTED_ECVT, value, ndigit, result, *decpt, *sign);
+    return result;
+}
+
+// Glibc stops at 17 decimal places.
+char * __unix_fcvt(double value, int ndigit, int *decpt, int *sign)
+{
+    struct CONVERTED *converted = find_converted(CONVERTED_FCVT, value, ndigit);
+    char *result;
+
+    if (is_converted(converted, CONVERTED_FCVT, value, ndigit)) {
+        *decpt = converted->decpt;
+        *sign = converted->sign;
+        return strcpy(fcvt_buffer, converted->str);
+    }
+
+    // Glibc does something odd when the result rounds to zero, so we leave
+    // that to it.
+    if (isfinite(value)
+     && value != 0
+     && ndigit >= 0
+     && fixed_digits(value, MIN(ndigit, MAX_DIGITS), fcvt_buffer, decpt)) {
+        *sign = signbit(value) != 0;
+        result = fcvt_buffer;
+    } else {
+        result = fcvt(value, ndigit, decpt, sign);
+    }
+
+    remember(converted, CONVERTED_FCVT, value, ndigit, result, *decpt, *sign);
+    return result;
+}
+
+// This is sprintf(buf, "%.*g", ndigit, value), with at most 17 digits.
+char * __unix_gcvt(double value, int ndigit, char *buf)
+{
+    struct CONVERTED *converted = find_converted(CONVERTED_GCVT, value, ndigit);
+    int precision = MIN(ndigit, MAX_DIGITS);
+    char digits[MAX_DIGITS + 1];
+    char *p = buf;
+    uint64_t number;
+    int decpt, len;
+
+    if (is_converted(converted, CONVERTED_GCVT, value, ndigit)) {
+        return strcpy(buf, converted->str);
+    }
+
+    // A negative precision means the default for printf(), so leave that to
+    // glibc too.
+    if (!isfinite(value)
+     || value == 0
+     || ndigit < 1
+     || !significant_digits(value, precision, &number, &decpt)) {
+        gcvt(value, ndigit, buf);
+        remember(converted, CONVERTED_GCVT, value, ndigit, buf, 0, 0);
+        return buf;
+    }
+
+    len = format_digits(digits, number, 1);
+
+    // Trailing zeros are removed.
+    while (len > 1 && digits[len - 1] == '0')
+        len--;
+
+    if (signbit(value))
+        *p++ = '-';
+
+    if (decpt - 1 < -4 || decpt - 1 >= precision) {
+        *p++ = digits[0];
+
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+
+        sprintf(p, "e%c%02d", decpt - 1 < 0 ? '-' : '+', abs(decpt - 1));
+    } else if (decpt <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -decpt);
+        p += -decpt;
+        memcpy(p, digits, len);
+        p[len] = '\0';
+    } else {
+        for (int i = 0; i < MAX(len, decpt); i++) {
+            if (i == decpt)
+                *p++ = '.';
+            *p++ = i < len ? digits[i] : '0';
+        }
+        *p = '\0';
+    }
+
+    remember(converted, CONVERTED_GCVT, value, ndigit, buf, 0, 0);
+    return buf;
+}
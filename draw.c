@@ -18,14 +18,14 @@
 #include "lotfuncs.h"
 #include "ttydraw.h"
 
-// The canvas used for drawing ascii-art graphics.
-extern caca_canvas_t *cv;
+// The canvas used for drawing ascii-art graphics, nothing is written to the
+// screen until the canvas is flushed.
+extern __thread caca_canvas_t *cv;
 
 void exprt_scan_linx(int x, int y, int width, int attr)
 {
     caca_set_attr(cv, attr);
     caca_draw_thin_line(cv, x, y, x + width, y);
-    refresh();
     return;
 }
 
@@ -33,7 +33,6 @@ void exprt_fill_rect(int x, int y, int width, int height, int attr)
 {
     caca_set_attr(cv, attr);
     caca_fill_box(cv, x, y, width, height, ' ');
-    refresh();
     return;
 }
 
@@ -41,7 +40,6 @@ void exprt_thin_diag_line(int x1, int y1, int x2, int y2, int attr)
 {
     caca_set_attr(cv, attr);
     caca_draw_thin_line(cv, x1, y1, x2, y2);
-    refresh();
     return;
 }
 
@@ -49,7 +47,6 @@ void exprt_thin_vert_line(int x, int y, int height, int attr)
 {
     caca_set_attr(cv, attr);
     caca_draw_thin_line(cv, x, y, x, y + height);
-    refresh();
     return;
 }
 
@@ -58,7 +55,6 @@ void exprt_shade_rect(struct POINT origin, struct POINT dim, PATT *fillpat, uint
 {
     caca_set_attr(cv, fillcolor);
     caca_fill_box(cv, origin.ptx, origin.pty, dim.ptx, dim.pty, fillpat->pattptr[0]);
-    refresh();
     return;
 }
 
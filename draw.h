@@ -2,7 +2,7 @@
 #define __DRAW_H
 
 // The canvas used for drawing ascii-art graphics.
-extern caca_canvas_t *cv;
+extern __thread caca_canvas_t *cv;
 
 void exprt_scan_linx(int x, int y, int width, int attr);
 void exprt_fill_rect(int x, int y, int width, int height, int attr);
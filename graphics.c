@@ -7,8 +7,11 @@
 #include <fcntl.h>
 #include <string.h>
 #include <err.h>
+#include <errno.h>
+#include <signal.h>
 #include <alloca.h>
 #include <curses.h>
+#include <term.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
@@ -19,10 +22,29 @@
 #include "lotfuncs.h"
 #include "ttydraw.h"
 #include "draw.h"
+#include "raster.h"
+#include "profile.h"
+#include "graphics.h"
 
 extern struct LOTUSFUNCS *core_funcs;
 extern int RastHandle;
-caca_canvas_t *cv;
+
+// The canvas that graphics primitives draw on. The rasterizer callbacks do
+// not take a context parameter, so this selects the target. It is thread
+// local so that other threads can render to their own canvas.
+__thread caca_canvas_t *cv;
+
+// If enabled, Lotus can show a graph in a window beside the worksheet, that
+// is redrawn whenever the data changes. The graph is rendered to
+// window_next, which is the size of the screen because Lotus draws in screen
+// coordinates. Only the area the graph has been drawn in is ever written to
+// the screen, window_shown is what's there now, and its top left corner is at
+// (window_x, window_y). Only cells that differ from it are redrawn.
+bool graph_window_enabled;
+static caca_canvas_t *window_next;
+static caca_canvas_t *window_shown;
+static int window_x;
+static int window_y;
 
 // The font used for drawing labels and legends on graphs.
 struct FONTINFO fontinfo = {
@@ -83,6 +105,84 @@ static struct DEVDATA devdata = {
     },
 };
 
+// Everything Lotus has written to the terminal since it last cleared the
+// screen. Writing it out again puts the worksheet back exactly as Lotus left
+// it, so it doesn't have to be repainted after a graph.
+static char *shadow;
+static size_t shadow_used;
+static size_t shadow_size;
+static bool shadow_valid;
+
+// If Lotus writes more than this without clearing the screen, replaying it
+// would be slower than a repaint.
+#define SHADOW_MAX (256 * 1024)
+
+// This is called by the write() wrapper with terminal output from Lotus.
+void save_text_output(const char *buf, size_t count)
+{
+    const char *start;
+
+    // Curses isn't initialized yet, so we can't recognize a clear.
+    if (cur_term == NULL || clear_screen == NULL || *clear_screen == '\0')
+        return;
+
+    // Nothing before a clear is visible, so start again from the last one.
+    for (start = buf; (start = memmem(start, count - (start - buf),
+                                      clear_screen,
+                                      strlen(clear_screen))); start++) {
+        shadow_used = 0;
+        shadow_valid = true;
+        count -= start - buf;
+        buf = start;
+    }
+
+    if (!shadow_valid)
+        return;
+
+    if (shadow_used + count > SHADOW_MAX) {
+        shadow_valid = false;
+        return;
+    }
+
+    if (shadow_used + count > shadow_size) {
+        size_t size = MAX(shadow_size * 2, shadow_used + count);
+        char *data = realloc(shadow, size);
+
+        if (data == NULL) {
+            shadow_valid = false;
+            return;
+        }
+
+        shadow = data;
+        shadow_size = size;
+    }
+
+    memcpy(shadow + shadow_used, buf, count);
+    shadow_used += count;
+}
+
+// Put the worksheet back on screen from the copy of the Lotus output.
+static bool restore_text_screen()
+{
+    size_t done;
+    ssize_t result;
+
+    if (!shadow_valid || shadow_used == 0)
+        return false;
+
+    for (done = 0; done < shadow_used; done += result) {
+        result = write(STDOUT_FILENO, shadow + done, shadow_used - done);
+
+        if (result < 0 && errno == EINTR) {
+            result = 0;
+        } else if (result < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // This is called when a graph is requested (F10).
 static int tty_disp_graph()
 {
@@ -90,12 +190,114 @@ static int tty_disp_graph()
     return 1;
 }
 
+// Forget what the graph window looks like, so that it is redrawn in full
+// next time.
+static void reset_graph_window()
+{
+    caca_free_canvas(window_next);
+    caca_free_canvas(window_shown);
+    window_next = window_shown = NULL;
+}
+
+// Make the area of the graph window on screen at least as big as the area
+// that was just drawn, writing it in full if it changed.
+static bool grow_graph_window()
+{
+    int x, y, width, height;
+    caca_canvas_t *shown;
+
+    // Nothing was drawn, so the area doesn't change.
+    if (caca_get_dirty_rect(window_next, 0, &x, &y, &width, &height) != 0)
+        return window_shown != NULL;
+
+    if (window_shown) {
+        int right = MAX(x + width, window_x + caca_get_canvas_width(window_shown));
+        int bottom = MAX(y + height, window_y + caca_get_canvas_height(window_shown));
+
+        x = MIN(x, window_x);
+        y = MIN(y, window_y);
+        width = right - x;
+        height = bottom - y;
+
+        if (x == window_x
+         && y == window_y
+         && width == caca_get_canvas_width(window_shown)
+         && height == caca_get_canvas_height(window_shown)) {
+            return true;
+        }
+    }
+
+    if ((shown = caca_create_canvas(width, height)) == NULL)
+        return false;
+
+    // We don't know what's on screen in the new area, so write all of it.
+    caca_clear_dirty_rect_list(window_next);
+    caca_add_dirty_rect(window_next, x, y, width, height);
+    caca_flush_canvas(window_next, 0, 0);
+    caca_blit(shown, -x, -y, window_next, NULL);
+
+    caca_free_canvas(window_shown);
+    window_shown = shown;
+    window_x = x;
+    window_y = y;
+    return true;
+}
+
+// Render a graph into the graph window, this happens while the worksheet is
+// still on screen.
+static int process_graph_window(struct GRAPH *graph)
+{
+    int result;
+
+    // If the terminal was resized, start again.
+    if (window_next && (caca_get_canvas_width(window_next) != COLS
+                     || caca_get_canvas_height(window_next) != LINES)) {
+        reset_graph_window();
+    }
+
+    if (window_next == NULL) {
+        window_next = caca_create_canvas(COLS, LINES);
+    }
+
+    // There's nowhere to draw it, so leave the window as it is.
+    if (window_next == NULL)
+        return 0;
+
+    caca_clear_canvas(window_next);
+
+    cv = window_next;
+    result = V3_disp_grph_process(graph);
+    cv = NULL;
+
+    // Anything in the old area that wasn't drawn this time is erased.
+    if (grow_graph_window()) {
+        caca_flush_canvas_changes(window_next, window_shown, window_x, window_y);
+    }
+
+    refresh();
+    return result;
+}
+
 // This is called when 1-2-3 exits graphics mode.
 static int tty_disp_text()
 {
     caca_free_canvas(cv);
+    cv = NULL;
+
+    // The full screen graph covered the graph window, if there is one.
+    reset_graph_window();
     clear();
     refresh();
+
+    // The graph was drawn over the worksheet on the same screen, the normal
+    // screen that 123 was started from is never touched. If we can replay the
+    // worksheet, the terminal is what Lotus thinks it is, so I think
+    // returning 0 skips the full repaint that 2 asks for. Only cells that
+    // changed while the graph was up are then redrawn.
+    if (restore_text_screen()) {
+        return 0;
+    }
+
     move(0, 0);
     return 2;
 }
@@ -106,13 +308,46 @@ static int tty_disp_grph_compute_view(void *p)
     return V3_disp_grph_compute_view(p);
 }
 
+// The view most recently selected by Lotus, this is needed to rasterize the
+// graph again at a different resolution.
+static void *cur_view;
+
+// Set by SIGUSR2 to save the next graph shown to LOTUS_GRAPH_EXPORT.
+static volatile sig_atomic_t export_requested;
+
+static void request_export(int signum)
+{
+    export_requested = signum == SIGUSR2;
+}
+
 static int tty_disp_grph_process(struct GRAPH *graph)
 {
-    return V3_disp_grph_process(graph);
+    const char *export = getenv("LOTUS_GRAPH_EXPORT");
+    int result;
+
+    // If we're not in graph mode, this must be for the graph window.
+    if (cv == NULL) {
+        return process_graph_window(graph);
+    }
+
+    result = V3_disp_grph_process(graph);
+
+    // The graph is rendered off-screen, now copy it to the terminal.
+    caca_flush_canvas(cv, 0, 0);
+    refresh();
+
+    // If requested, also save a high resolution copy of the graph.
+    if (export_requested && export && cur_view) {
+        export_requested = false;
+        export_graph_bitmap(&devdata, graph, cur_view, export);
+    }
+
+    return result;
 }
 
 static int tty_disp_grph_set_cur_view(void *view)
 {
+    cur_view = view;
     return V3_disp_grph_set_cur_view(view);
 }
 
@@ -144,9 +379,9 @@ static void tty_disp_info(struct DISPLAYINFO *dpyinfo)
     dpyinfo->graph_rows = LINES;
     dpyinfo->graph_col_res = 1;
     dpyinfo->graph_row_res = 1;
-    dpyinfo->view_set_size = 178;
+    dpyinfo->view_set_size = VIEW_SET_SIZE;
     dpyinfo->iscolor = true;
-    dpyinfo->sep_graph_win = false;
+    dpyinfo->sep_graph_win = graph_window_enabled;
 }
 
 // The original function.
@@ -227,13 +462,25 @@ static void draw_text_label()
     uint16_t    y = MapY(*(uint16_t *)(vmr[0] + 2));
     char    **str = (void *)(vmr[0] + 6);
     uint16_t *len = (void *)(vmr[0] + 4);
+    static const int turns[] = { [0] = 0, [1] = 1, [2] = 2, [4] = 3 };
+
+    // If a graph is being exported, the label goes in the image. I think
+    // MapX() and MapY() use the device of the rasterizer that is running.
+    if (export_text_label(x, y, *str, *len, turns[TextAngle])) {
+        return;
+    }
+
+    // There is nowhere else to draw text.
+    if (cv == NULL) {
+        return;
+    }
 
     switch (TextAngle) {
         // Horizontal
         case 0: // I think (x,y) is the midpoint.
                 x -= *len / 2;
                 for (int c = 0; c < *len; c++) {
-                    mvaddch(y, x + c, (*str)[c]);
+                    caca_put_char(cv, x + c, y, (*str)[c]);
                 }
                 break;
         // Vertical
@@ -241,14 +488,13 @@ static void draw_text_label()
                 y -= *len / 2;
                 // Write each character in a vertical line.
                 for (int c = 0; c < *len; c++) {
-                    mvaddch(y + c, x, (*str)[c]);
+                    caca_put_char(cv, x, y + c, (*str)[c]);
                 }
                 break;
         case 2:
         case 4:
                 warnx("unsupported text angle, please report this!");
     }
-    refresh();
     return;
 }
 
@@ -318,5 +564,14 @@ int init_unix_display_code()
     dliclose = nullfunc;
     opcodes[26] = draw_text_label;
     opcodes[10] = set_text_angle;
+
+    // This does nothing unless LOTUS_PROFILE is set.
+    profile_dispatch();
+
+    // Graphs are only exported when you ask, because it takes a while.
+    if (getenv("LOTUS_GRAPH_EXPORT")) {
+        signal(SIGUSR2, request_export);
+    }
+
     return disp_txt_init(char_set_bundle);
 }
@@ -0,0 +1,6 @@
+#ifndef __GRAPHICS_H
+#define __GRAPHICS_H
+
+void save_text_output(const char *buf, size_t count);
+
+#endif
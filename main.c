@@ -12,6 +12,7 @@
 
 extern int __unix_main(int argc, char **argv, char **envp);
 extern int setchrclass(const char *class);
+extern bool graph_window_enabled;
 
 static void hide_option_from_lotus(int *argc, char **argv) {
     // Now move optind back one position
@@ -34,6 +35,7 @@ static void print_help()
     // it's own help, so we can append any flags we support.
     printf("        -b                      to enable banner\n");
     printf("        -u                      to disable undo support\n");
+    printf("        -g                      to enable the graph window\n");
 }
 
 int main(int argc, char **argv, char **envp)
@@ -61,7 +63,7 @@ int main(int argc, char **argv, char **envp)
     // Enable undo by default, you can disable it via -u.
     reset_undo(1);
 
-    while ((opt = getopt(argc, argv, "f:c:k:np:w:hbu")) != -1) {
+    while ((opt = getopt(argc, argv, "f:c:k:np:w:hbug")) != -1) {
         switch (opt) {
             case 'b': banner_printed = false;
                       hide_option_from_lotus(&argc, argv);
@@ -69,6 +71,9 @@ int main(int argc, char **argv, char **envp)
             case 'u': undo_off_cmd();
                       hide_option_from_lotus(&argc, argv);
                       break;
+            case 'g': graph_window_enabled = true;
+                      hide_option_from_lotus(&argc, argv);
+                      break;
             case '?':
             case 'h': atexit(print_help);
                       break;
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "profile.h"
+
+// This is an opt-in profiler for the Lotus dispatch tables. If LOTUS_PROFILE
+// is set, every handler in the @function table and the opcodes[] table (which
+// is how Lotus interprets the graph metafile) is replaced with a thunk that
+// counts the calls to it and the cycles spent inside it, then calls the
+// original.
+//
+// Lotus doesn't tell us how big these tables are, so we read the symbol table
+// of our own executable. A table ends where the next symbol starts, and an
+// entry is only wrapped if it points at the start of a function.
+//
+// The report is appended to the file named by LOTUS_PROFILE, or to
+// 123-profile.txt if it is just set to 1, so that it doesn't scribble over
+// the worksheet. It is written on exit, or whenever you send SIGUSR1. It isn't
+// safe to write from a signal handler, so the handler just sets a flag, and
+// the report is written the next time Lotus reads the keyboard, see
+// profile_poll().
+
+#define MAX_ENTRIES 512
+#define DEFAULT_REPORT "123-profile.txt"
+
+struct PROFILE_ENTRY {
+    const char *table;
+    int index;
+    const char *name;
+    void *slot;
+    int64_t (*original)(void);
+    uint32_t calls;
+    uint64_t cycles;
+};
+
+static struct PROFILE_ENTRY entries[MAX_ENTRIES];
+static int num_entries;
+static FILE *report;
+
+// The symbol table of /proc/self/exe, sorted by address.
+static const ElfW(Shdr) *sections;
+static int num_sections;
+static const char *symnames;
+static const ElfW(Sym) **symbols;
+static size_t num_symbols;
+
+// Set by SIGUSR1 to write a report from profile_poll().
+static volatile sig_atomic_t report_requested;
+
+// We don't know what the handlers return, I think @functions return a status
+// in ax. Returning edx:eax untouched covers anything that fits in registers.
+static int64_t profile_call(int n)
+{
+    uint64_t start = __builtin_ia32_rdtsc();
+    int64_t result = entries[n].original();
+
+    // Note that this includes any nested calls, e.g. @functions used as
+    // arguments to other @functions.
+    entries[n].cycles += __builtin_ia32_rdtsc() - start;
+    entries[n].calls++;
+    return result;
+}
+
+// Lotus calls the handlers without any parameters, so we need a separate
+// thunk for every entry to know which one it was.
+#define THUNK(n) static int64_t thunk_##n(void) { return profile_call(n); }
+#define THUNKS(h)                                                           \
+    THUNK(0x##h##0) THUNK(0x##h##1) THUNK(0x##h##2) THUNK(0x##h##3)         \
+    THUNK(0x##h##4) THUNK(0x##h##5) THUNK(0x##h##6) THUNK(0x##h##7)         \
+    THUNK(0x##h##8) THUNK(0x##h##9) THUNK(0x##h##a) THUNK(0x##h##b)         \
+    THUNK(0x##h##c) THUNK(0x##h##d) THUNK(0x##h##e) THUNK(0x##h##f)
+#define ENTRIES(h)                                                          \
+    thunk_0x##h##0, thunk_0x##h##1, thunk_0x##h##2, thunk_0x##h##3,         \
+    thunk_0x##h##4, thunk_0x##h##5, thunk_0x##h##6, thunk_0x##h##7,         \
+    thunk_0x##h##8, thunk_0x##h##9, thunk_0x##h##a, thunk_0x##h##b,         \
+    thunk_0x##h##c, thunk_0x##h##d, thunk_0x##h##e, thunk_0x##h##f,
+
+THUNKS(00) THUNKS(01) THUNKS(02) THUNKS(03) THUNKS(04) THUNKS(05) THUNKS(06)
+THUNKS(07) THUNKS(08) THUNKS(09) THUNKS(0a) THUNKS(0b) THUNKS(0c) THUNKS(0d)
+THUNKS(0e) THUNKS(0f) THUNKS(10) THUNKS(11) THUNKS(12) THUNKS(13) THUNKS(14)
+THUNKS(15) THUNKS(16) THUNKS(17) THUNKS(18) THUNKS(19) THUNKS(1a) THUNKS(1b)
+THUNKS(1c) THUNKS(1d) THUNKS(1e) THUNKS(1f)
+
+static int64_t (*thunks[MAX_ENTRIES])(void) = {
+    ENTRIES(00) ENTRIES(01) ENTRIES(02) ENTRIES(03) ENTRIES(04) ENTRIES(05)
+    ENTRIES(06) ENTRIES(07) ENTRIES(08) ENTRIES(09) ENTRIES(0a) ENTRIES(0b)
+    ENTRIES(0c) ENTRIES(0d) ENTRIES(0e) ENTRIES(0f) ENTRIES(10) ENTRIES(11)
+    ENTRIES(12) ENTRIES(13) ENTRIES(14) ENTRIES(15) ENTRIES(16) ENTRIES(17)
+    ENTRIES(18) ENTRIES(19) ENTRIES(1a) ENTRIES(1b) ENTRIES(1c) ENTRIES(1d)
+    ENTRIES(1e) ENTRIES(1f)
+};
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const ElfW(Sym) *x = *(const ElfW(Sym) **) a;
+    const ElfW(Sym) *y = *(const ElfW(Sym) **) b;
+
+    return x->st_value < y->st_value ? -1 : x->st_value > y->st_value;
+}
+
+// Map our own executable and collect every symbol that has an address.
+static bool load_symbols()
+{
+    const ElfW(Ehdr) *ehdr;
+    const ElfW(Shdr) *symtab = NULL;
+    const ElfW(Sym) *syms;
+    struct stat st;
+    char *image;
+    int fd;
+
+    if ((fd = open("/proc/self/exe", O_RDONLY)) < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof *ehdr) {
+        close(fd);
+        return false;
+    }
+
+    // This is never unmapped, the names are used in the report.
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED)
+        return false;
+
+    ehdr = (const ElfW(Ehdr) *) image;
+
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+     || ehdr->e_shoff + ehdr->e_shnum * sizeof *sections > (size_t) st.st_size)
+        return false;
+
+    sections = (const ElfW(Shdr) *) (image + ehdr->e_shoff);
+    num_sections = ehdr->e_shnum;
+
+    for (int i = 0; i < num_sections; i++) {
+        if (sections[i].sh_type == SHT_SYMTAB)
+            symtab = &sections[i];
+    }
+
+    // The symbol table was stripped.
+    if (symtab == NULL || symtab->sh_link >= num_sections)
+        return false;
+
+    syms = (const ElfW(Sym) *) (image + symtab->sh_offset);
+    symnames = image + sections[symtab->sh_link].sh_offset;
+    symbols = calloc(symtab->sh_size / sizeof *syms, sizeof *symbols);
+
+    if (symbols == NULL)
+        return false;
+
+    for (size_t i = 0; i < symtab->sh_size / sizeof *syms; i++) {
+        if (syms[i].st_shndx == SHN_UNDEF || syms[i].st_shndx >= num_sections)
+            continue;
+        if (ELF32_ST_TYPE(syms[i].st_info) == STT_SECTION
+         || ELF32_ST_TYPE(syms[i].st_info) == STT_FILE
+         || syms[i].st_name == 0)
+            continue;
+        symbols[num_symbols++] = &syms[i];
+    }
+
+    qsort(symbols, num_symbols, sizeof *symbols, compare_symbols);
+    return true;
+}
+
+static const ElfW(Sym) *find_symbol(const char *name)
+{
+    for (size_t i = 0; i < num_symbols; i++) {
+        if (strcmp(symnames + symbols[i]->st_name, name) == 0)
+            return symbols[i];
+    }
+    return NULL;
+}
+
+// The index of the first symbol at or after addr.
+static size_t lower_bound(uintptr_t addr)
+{
+    size_t lo = 0, hi = num_symbols;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (symbols[mid]->st_value < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+// The size of a symbol, objects converted from COFF don't have one, so use
+// the distance to whatever follows it in the same section.
+static size_t symbol_size(const ElfW(Sym) *sym)
+{
+    const ElfW(Shdr) *section = &sections[sym->st_shndx];
+
+    if (sym->st_size)
+        return sym->st_size;
+
+    for (size_t i = lower_bound(sym->st_value + 1); i < num_symbols; i++) {
+        if (symbols[i]->st_shndx == sym->st_shndx)
+            return symbols[i]->st_value - sym->st_value;
+    }
+
+    return section->sh_addr + section->sh_size - sym->st_value;
+}
+
+// The name of the function that starts at addr, or NULL if it isn't the
+// start of a function.
+static const char *function_name(uintptr_t addr)
+{
+    for (size_t i = lower_bound(addr); i < num_symbols; i++) {
+        if (symbols[i]->st_value != addr)
+            break;
+        if (sections[symbols[i]->st_shndx].sh_flags & SHF_EXECINSTR)
+            return symnames + symbols[i]->st_name;
+    }
+
+    return NULL;
+}
+
+static bool is_writable(const ElfW(Sym) *sym)
+{
+    return sections[sym->st_shndx].sh_flags & SHF_WRITE;
+}
+
+// Find the writable object that contains a pointer to target, and where.
+static const ElfW(Sym) *find_reference(uintptr_t target, size_t *offset)
+{
+    for (size_t i = 0; i < num_symbols; i++) {
+        const char *base = (const char *) symbols[i]->st_value;
+        size_t size;
+
+        if (!is_writable(symbols[i]))
+            continue;
+
+        size = symbol_size(symbols[i]);
+
+        for (size_t off = 0; off + sizeof target <= size; off++) {
+            uintptr_t value;
+
+            memcpy(&value, base + off, sizeof value);
+
+            if (value == target) {
+                *offset = off;
+                return symbols[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Replace every function pointer in the table with a thunk. The entries might
+// be structures rather than bare pointers, so step over every word that has
+// the same alignment as a known entry, and skip anything that isn't a
+// function.
+static void wrap_table(const char *name, const ElfW(Sym) *table, size_t align)
+{
+    char *base = (char *) table->st_value;
+    size_t size = symbol_size(table);
+
+    for (size_t off = align % sizeof(void *); off + sizeof(void *) <= size;
+                                              off += sizeof(void *)) {
+        struct PROFILE_ENTRY *entry = &entries[num_entries];
+        const char *function;
+        uintptr_t handler;
+
+        memcpy(&handler, base + off, sizeof handler);
+
+        if ((function = function_name(handler)) == NULL)
+            continue;
+
+        if (num_entries == MAX_ENTRIES) {
+            warnx("too many entries in %s, some were not profiled", name);
+            return;
+        }
+
+        entry->name = function;
+        entry->table = name;
+        entry->index = off / sizeof(void *);
+        entry->slot = base + off;
+        entry->original = (int64_t (*)(void)) handler;
+
+        memcpy(entry->slot, &thunks[num_entries], sizeof(void *));
+        num_entries++;
+    }
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct PROFILE_ENTRY *x = &entries[*(const int *) a];
+    const struct PROFILE_ENTRY *y = &entries[*(const int *) b];
+
+    return x->cycles < y->cycles ? 1 : x->cycles > y->cycles ? -1 : 0;
+}
+
+static void print_profile_report()
+{
+    int ranked[MAX_ENTRIES];
+    uint64_t total = 0;
+
+    for (int i = 0; i < num_entries; i++) {
+        ranked[i] = i;
+        total += entries[i].cycles;
+    }
+
+    // Busiest first.
+    qsort(ranked, num_entries, sizeof *ranked, compare_entries);
+
+    fprintf(report, "%-24s %-16s %10s %16s %12s %7s\n",
+                    "handler",
+                    "table",
+                    "calls",
+                    "cycles",
+                    "cycles/call",
+                    "%");
+
+    for (int i = 0; i < num_entries; i++) {
+        struct PROFILE_ENTRY *entry = &entries[ranked[i]];
+
+        if (entry->calls == 0)
+            break;
+
+        fprintf(report, "%-24s %-10s[%4d] %10u %16" PRIu64 " %12" PRIu64 " %6.2f%%\n",
+                        entry->name,
+                        entry->table,
+                        entry->index,
+                        entry->calls,
+                        entry->cycles,
+                        entry->cycles / entry->calls,
+                        100.0 * entry->cycles / total);
+    }
+
+    fputc('\n', report);
+    fflush(report);
+}
+
+static void profile_signal(int signum)
+{
+    report_requested = signum == SIGUSR1;
+}
+
+// This is called from the keyboard read wrapper, which is about as close to
+// a main loop as we have.
+void profile_poll()
+{
+    if (report_requested) {
+        report_requested = false;
+        print_profile_report();
+    }
+}
+
+// Put the original handlers back and write the report.
+static void finish_profile()
+{
+    for (int i = 0; i < num_entries; i++) {
+        memcpy(entries[i].slot, &entries[i].original, sizeof(void *));
+    }
+
+    print_profile_report();
+    fclose(report);
+}
+
+// Wrap the dispatch tables, this has to be called after we've replaced any of
+// the handlers we care about.
+void profile_dispatch()
+{
+    const char *setting = getenv("LOTUS_PROFILE");
+    const ElfW(Sym) *table;
+    size_t offset;
+
+    if (setting == NULL || report)
+        return;
+
+    if (*setting == '\0' || strcmp(setting, "1") == 0) {
+        setting = DEFAULT_REPORT;
+    }
+
+    if (!load_symbols()) {
+        warnx("LOTUS_PROFILE needs the symbol table of %s, it was stripped?",
+              program_invocation_name);
+        return;
+    }
+
+    if ((report = fopen(setting, "a")) == NULL) {
+        warn("failed to open the profile report %s", setting);
+        return;
+    }
+
+    // We don't know the name of the @function table, but our own at_date()
+    // replaces the Lotus one, so I think the table is whatever refers to it.
+    if ((table = find_symbol("at_date"))
+     && (table = find_reference(table->st_value, &offset))) {
+        wrap_table(symnames + table->st_name, table, offset);
+    } else {
+        warnx("couldn't find the @function table, it won't be profiled");
+    }
+
+    if ((table = find_symbol("opcodes"))) {
+        wrap_table("opcodes", table, 0);
+    }
+
+    signal(SIGUSR1, profile_signal);
+    atexit(finish_profile);
+}
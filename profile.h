@@ -0,0 +1,7 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+void profile_dispatch();
+void profile_poll();
+
+#endif
@@ -0,0 +1,522 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/param.h>
+
+#include "lotdefs.h"
+#include "lottypes.h"
+#include "lotfuncs.h"
+#include "raster.h"
+
+extern struct LOTUSFUNCS *core_funcs;
+
+// Graphs are exported at this resolution unless LOTUS_GRAPH_DPI is set.
+#define DEFAULT_EXPORT_DPI 300
+
+// The exported page is landscape letter with half inch margins, i.e. 10 by
+// 7.5 inches.
+#define EXPORT_PAGE_WIDTH(dpi) ((dpi) * 10)
+#define EXPORT_PAGE_HEIGHT(dpi) ((dpi) * 15 / 2)
+
+// The number of raster lines in each strip, set_strip() selects which of them
+// the rasterizer draws.
+#define STRIP_HEIGHT 128
+
+// Labels are drawn with a 5x7 font, scaled up so that a character is about
+// this many dots per inch high, and in white like text on the terminal.
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+#define GLYPH_DPI 50
+#define LABEL_COLOR 7
+
+// The image being rendered, and the strip of it the rasterizer is currently
+// working on. Every worker process has a private copy of these, but the
+// pixels are in a shared mapping.
+static struct BITMAP *target;
+static int strip_top;
+static int strip_bottom;
+static int glyph_scale;
+
+// The rightmost pixel this process was asked to draw, even if it was outside
+// the image. This is in a shared mapping too, one per worker.
+static int *rightmost;
+
+// These are the RGB values of the curses colors used on the screen, so that
+// exported graphs look the same.
+static const uint8_t palette[8][3] = {
+    { 0x00, 0x00, 0x00 },   // Black
+    { 0xCD, 0x00, 0x00 },   // Red
+    { 0x00, 0xCD, 0x00 },   // Green
+    { 0xCD, 0xCD, 0x00 },   // Yellow
+    { 0x00, 0x00, 0xEE },   // Blue
+    { 0xCD, 0x00, 0xCD },   // Magenta
+    { 0x00, 0xCD, 0xCD },   // Cyan
+    { 0xE5, 0xE5, 0xE5 },   // White
+};
+
+// The printable ASCII characters, starting with space. Each row is five bits,
+// the most significant is the leftmost pixel.
+static const uint8_t font[][GLYPH_HEIGHT] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },   // Space
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },   // !
+    { 0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00 },   // "
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A },   // #
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 },   // $
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },   // %
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D },   // &
+    { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 },   // '
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },   // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },   // )
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 },   // *
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },   // +
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 },   // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },   // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },   // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },   // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },   // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },   // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },   // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },   // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },   // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },   // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },   // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },   // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },   // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },   // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },   // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 },   // ;
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },   // <
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },   // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },   // >
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },   // ?
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E },   // @
+    { 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 },   // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },   // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },   // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },   // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },   // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },   // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },   // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },   // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },   // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },   // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },   // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },   // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },   // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },   // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },   // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },   // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },   // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },   // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },   // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },   // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },   // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },   // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },   // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },   // X
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },   // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },   // Z
+    { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E },   // [
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },   // Backslash
+    { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E },   // ]
+    { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 },   // ^
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F },   // _
+    { 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 },   // `
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F },   // a
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E },   // b
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E },   // c
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F },   // d
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E },   // e
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 },   // f
+    { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E },   // g
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },   // h
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E },   // i
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C },   // j
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },   // k
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },   // l
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11 },   // m
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },   // n
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E },   // o
+    { 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10 },   // p
+    { 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01 },   // q
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },   // r
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E },   // s
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 },   // t
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D },   // u
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 },   // v
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A },   // w
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 },   // x
+    { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E },   // y
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F },   // z
+    { 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 },   // {
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },   // |
+    { 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 },   // }
+    { 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 },   // ~
+};
+
+// Fill a horizontal run of pixels, clipped to the current strip.
+static void fill_span(int x1, int x2, int y, int color)
+{
+    *rightmost = MAX(*rightmost, x2);
+
+    if (y < strip_top || y >= strip_bottom)
+        return;
+
+    x1 = MAX(x1, 0);
+    x2 = MIN(x2, target->width - 1);
+
+    if (x1 > x2)
+        return;
+
+    memset(&target->pixels[y * target->width + x1], color, x2 - x1 + 1);
+}
+
+static void put_pixel(int x, int y, int color)
+{
+    fill_span(x, x, y, color);
+}
+
+static void bitmap_scan_linx(int x, int y, int width, int attr)
+{
+    fill_span(x, x + width, y, attr);
+}
+
+static void bitmap_fill_rect(int x, int y, int width, int height, int attr)
+{
+    // Only the part inside this strip can be drawn.
+    int top = MAX(y, strip_top);
+    int bottom = MIN(y + height, strip_bottom);
+
+    for (int row = top; row < bottom; row++) {
+        fill_span(x, x + width - 1, row, attr);
+    }
+}
+
+static void bitmap_thin_diag_line(int x1, int y1, int x2, int y2, int attr)
+{
+    int dx = abs(x2 - x1);
+    int dy = -abs(y2 - y1);
+    int sx = x1 < x2 ? 1 : -1;
+    int sy = y1 < y2 ? 1 : -1;
+    int error = dx + dy;
+    int step;
+
+    // This is just Bresenham.
+    while (true) {
+        put_pixel(x1, y1, attr);
+
+        if (x1 == x2 && y1 == y2)
+            break;
+
+        // Both tests have to use the error from before this step.
+        step = 2 * error;
+
+        if (step >= dy) {
+            error += dy;
+            x1 += sx;
+        }
+        if (step <= dx) {
+            error += dx;
+            y1 += sy;
+        }
+    }
+}
+
+static void bitmap_thin_vert_line(int x, int y, int height, int attr)
+{
+    int top = MAX(y, strip_top);
+    int bottom = MIN(y + height, strip_bottom - 1);
+
+    for (int row = top; row <= bottom; row++) {
+        put_pixel(x, row, attr);
+    }
+}
+
+// On the terminal each fill pattern is a different character, here we use
+// diagonal hatching spaced by the pattern size instead.
+static void bitmap_shade_rect(struct POINT origin,
+                              struct POINT dim,
+                              PATT *fillpat,
+                              uint16_t fillcolor)
+{
+    int spacing = MAX(fillpat->pattsize.ptx / 2, 2);
+    int top = MAX(origin.pty, strip_top);
+    int bottom = MIN(origin.pty + dim.pty, strip_bottom);
+
+    for (int y = top; y < bottom; y++) {
+        for (int x = origin.ptx; x < origin.ptx + dim.ptx; x++) {
+            if ((x + y) % spacing == 0) {
+                put_pixel(x, y, fillcolor);
+            }
+        }
+    }
+}
+
+static void bitmap_fill_scan_list()
+{
+    return;
+}
+
+// Draw a label into the graph being exported, see draw_text_label(). The text
+// is turned anticlockwise by quarter turns, and (x,y) is its midpoint like on
+// the terminal. Returns false if no graph is being exported.
+bool export_text_label(int x, int y, const char *str, int len, int turns)
+{
+    // The direction the text runs in, and the direction of "down" in a glyph.
+    static const int across[4][2] = { { 1, 0 }, { 0, -1 }, { -1, 0 }, { 0, 1 } };
+    static const int down[4][2] = { { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 } };
+    const int *run = across[turns & 3];
+    const int *fall = down[turns & 3];
+    int advance = (GLYPH_WIDTH + 1) * glyph_scale;
+    int width = len * advance;
+    int height = GLYPH_HEIGHT * glyph_scale;
+
+    if (target == NULL)
+        return false;
+
+    // Move from the midpoint to the top left of the first glyph.
+    x -= run[0] * width / 2 + fall[0] * height / 2;
+    y -= run[1] * width / 2 + fall[1] * height / 2;
+
+    for (int c = 0; c < len; c++) {
+        uint8_t ch = str[c];
+        const uint8_t *glyph = font[ch >= ' ' && ch <= '~' ? ch - ' ' : '?' - ' '];
+
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < GLYPH_WIDTH * glyph_scale; col++) {
+                int along = c * advance + col;
+
+                if (!(glyph[row / glyph_scale] & (0x10 >> col / glyph_scale)))
+                    continue;
+
+                put_pixel(x + run[0] * along + fall[0] * row,
+                          y + run[1] * along + fall[1] * row,
+                          LABEL_COLOR);
+            }
+        }
+    }
+
+    return true;
+}
+
+// Rasterize the strips between first and last (exclusive) into target.
+static void render_strips(int handle, struct GRAPH *graph, int first, int last)
+{
+    for (int top = first; top < last; top += STRIP_HEIGHT) {
+        strip_top = top;
+        strip_bottom = MIN(top + STRIP_HEIGHT, last);
+
+        // I think this selects which band of the device the following
+        // raster() call will produce.
+        core_funcs->set_strip(strip_top, strip_bottom);
+        core_funcs->raster(handle, graph);
+    }
+}
+
+static int write_ppm(const struct BITMAP *image, const char *filename)
+{
+    FILE *out = fopen(filename, "w");
+    uint8_t *row = malloc(image->width * sizeof palette[0]);
+
+    if (out == NULL || row == NULL) {
+        free(row);
+        if (out) fclose(out);
+        return -1;
+    }
+
+    fprintf(out, "P6\n%d %d\n255\n", image->width, image->height);
+
+    // Convert the color indexes a row at a time, so that there's one write
+    // per row rather than per pixel.
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *pixels = &image->pixels[y * image->width];
+
+        for (int x = 0; x < image->width; x++) {
+            memcpy(&row[x * sizeof palette[0]], palette[pixels[x] & 7], sizeof palette[0]);
+        }
+
+        fwrite(row, sizeof palette[0], image->width, out);
+    }
+
+    free(row);
+    return fclose(out);
+}
+
+// Rasterize the whole image, and return the rightmost pixel the rasterizer
+// tried to draw.
+//
+// The Lotus rasterizer is not reentrant, so the strips can't be rendered on
+// threads. Instead we fork one worker per cpu, and each worker rasterizes a
+// contiguous group of strips with its own copy-on-write copy of the
+// rasterizer state. The pixels are in a shared mapping, so the strips are
+// stitched together for free.
+static int render_image(int handle, struct GRAPH *graph, struct BITMAP *image)
+{
+    int nworkers = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+    int rows;
+    int result = -1;
+    int *extents;
+    pid_t *workers;
+
+    nworkers = MIN(nworkers, howmany(image->height, STRIP_HEIGHT));
+    rows = roundup(howmany(image->height, nworkers), STRIP_HEIGHT);
+    workers = calloc(nworkers, sizeof *workers);
+    extents = mmap(NULL,
+                   nworkers * sizeof *extents,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS,
+                   -1,
+                   0);
+
+    target = image;
+
+    // If we can't keep track of workers, just do all the work ourselves.
+    if (workers == NULL || extents == MAP_FAILED) {
+        rightmost = &result;
+        render_strips(handle, graph, 0, image->height);
+        target = NULL;
+
+        free(workers);
+        if (extents != MAP_FAILED) munmap(extents, nworkers * sizeof *extents);
+        return result;
+    }
+
+    for (int w = 0; w < nworkers; w++) {
+        int first = w * rows;
+        int last = MIN(first + rows, image->height);
+
+        extents[w] = -1;
+        rightmost = &extents[w];
+
+        if (first >= last)
+            break;
+
+        workers[w] = fork();
+
+        if (workers[w] == 0) {
+            render_strips(handle, graph, first, last);
+
+            // Don't run any atexit handlers, they belong to the parent.
+            _exit(EXIT_SUCCESS);
+        }
+
+        // If we couldn't fork, just do the work ourselves.
+        if (workers[w] < 0) {
+            render_strips(handle, graph, first, last);
+        }
+    }
+
+    for (int w = 0; w < nworkers; w++) {
+        int status;
+
+        if (workers[w] > 0) {
+            if (waitpid(workers[w], &status, 0) != workers[w] || !WIFEXITED(status)) {
+                warnx("a graph export worker failed, the image may be incomplete");
+            }
+        }
+
+        result = MAX(result, extents[w]);
+    }
+
+    target = NULL;
+    free(workers);
+    munmap(extents, nworkers * sizeof *extents);
+    return result;
+}
+
+// Render a graph at bitmap resolution and save it as a PPM image.
+int export_graph_bitmap(const struct DEVDATA *devtemplate,
+                        struct GRAPH *graph,
+                        const void *view,
+                        const char *filename)
+{
+    struct DEVDATA *devinfo;
+    struct BITMAP image;
+    const char *dpienv = getenv("LOTUS_GRAPH_DPI");
+    int dpi = dpienv ? atoi(dpienv) : DEFAULT_EXPORT_DPI;
+    uint8_t bitmap_view[VIEW_SET_SIZE];
+    int handle;
+    int extent;
+
+    if (dpi <= 0) {
+        dpi = DEFAULT_EXPORT_DPI;
+    }
+
+    image.width = EXPORT_PAGE_WIDTH(dpi);
+    image.height = EXPORT_PAGE_HEIGHT(dpi);
+    glyph_scale = MAX(dpi / GLYPH_DPI, 1);
+
+    // Lotus wants the device description in its own memory, so open the
+    // rasterizer the same way caca_disp_open() does. This is our own device,
+    // the terminal device Lotus allocated is still in use.
+    devinfo = core_funcs->alloc_mptr(0x27, sizeof *devinfo, 1);
+
+    if (devinfo == NULL) {
+        warnx("failed to allocate a device to export the graph");
+        return -1;
+    }
+
+    // Describe a bitmap device with square pixels that is as tall as the
+    // image, otherwise the same as the terminal.
+    memcpy(devinfo, devtemplate, sizeof *devinfo);
+    devinfo->RasterHeight = image.height;
+    devinfo->AspectX = 1;
+    devinfo->AspectY = 1;
+    devinfo->DevFuncs.scan_linx = bitmap_scan_linx;
+    devinfo->DevFuncs.fill_rect = bitmap_fill_rect;
+    devinfo->DevFuncs.thin_diag_line = bitmap_thin_diag_line;
+    devinfo->DevFuncs.thin_vert_line = bitmap_thin_vert_line;
+    devinfo->DevFuncs.shade_rect = (void *) bitmap_shade_rect;
+    devinfo->DevFuncs.fill_scan_list = bitmap_fill_scan_list;
+
+    handle = core_funcs->open_rasterizer(core_funcs->drv_get_vmr(1));
+
+    // The view Lotus selected was computed for the terminal, so compute a
+    // copy of it again for this device.
+    memcpy(bitmap_view, view, sizeof bitmap_view);
+    core_funcs->rast_compute_view(handle, bitmap_view);
+
+    // I think the rasterizer takes the height from RasterHeight, and with
+    // square pixels the 4:3 page makes it the width of the image. If it drew
+    // past the edge anyway, that was wrong, so render it again wide enough.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        image.pixels = mmap(NULL,
+                            image.width * image.height,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS,
+                            -1,
+                            0);
+
+        if (image.pixels == MAP_FAILED) {
+            warn("failed to allocate a %dx%d image", image.width, image.height);
+            break;
+        }
+
+        extent = render_image(handle, graph, &image);
+
+        if (extent < image.width || attempt > 0) {
+            if (write_ppm(&image, filename) != 0) {
+                warn("failed to write graph to %s", filename);
+            }
+        }
+
+        munmap(image.pixels, image.width * image.height);
+
+        if (extent < image.width)
+            break;
+
+        image.width = extent + 1;
+    }
+
+    core_funcs->close_rasterizer(handle);
+    core_funcs->free_mptr(devinfo, sizeof *devinfo);
+    return image.pixels == MAP_FAILED ? -1 : 0;
+}
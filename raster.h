@@ -0,0 +1,20 @@
+#ifndef __RASTER_H
+#define __RASTER_H
+
+// An image rendered by the Lotus rasterizer at bitmap resolution.
+struct BITMAP {
+    int width;
+    int height;
+    uint8_t *pixels;    // One color index per pixel.
+};
+
+// The size of a view, which we tell Lotus in tty_disp_info().
+#define VIEW_SET_SIZE 178
+
+bool export_text_label(int x, int y, const char *str, int len, int turns);
+int export_graph_bitmap(const struct DEVDATA *devtemplate,
+                        struct GRAPH *graph,
+                        const void *view,
+                        const char *filename);
+
+#endif
@@ -0,0 +1,427 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <search.h>
+#include <sys/param.h>
+
+// Native versions of the libc search functions.
+//
+// Lotus uses hsearch(), tsearch(), lsearch() and bsearch() internally. The
+// hsearch() table is a single global with a fixed size chosen by hcreate(),
+// and glibc makes that a prime number of chained buckets, so it's slow once
+// it fills up and ENTER fails when it's full. Our table is open addressing
+// and grows as needed, but the entries themselves never move, because
+// callers can keep the pointers hsearch() returns.
+//
+// The others are only counted. tsearch() has to return tree nodes whose first
+// member is the key, and twalk() has to visit them in binary tree order, so a
+// B-tree can't keep the same semantics. lsearch() and lfind() only have a
+// comparison function that says whether two elements are equal, so we can't
+// hash them either.
+//
+// LOTUS_SEARCH can be set to "off" to use the glibc hsearch(), or "report" to
+// print every call site, how often it was called and how large the table,
+// tree or array got on exit. The call sites are addresses in 123, use
+// addr2line -f -e 123 to find out where they are.
+
+// The first table is at least this big.
+#define MIN_SLOTS 64
+
+// The entries are allocated in blocks of this many, so that they never move.
+#define BLOCK_ENTRIES 256
+
+// The most call sites the report can track.
+#define MAX_CALL_SITES 256
+
+// The most trees the report can track the sizes of.
+#define MAX_TREES 256
+
+struct HTABLE {
+    uint32_t nslots;            // Always a power of two.
+    uint32_t count;
+    uint32_t *slots;            // Entry number plus one, 0 if unused.
+    uint32_t *hashes;           // The hash of the key in each slot.
+    ENTRY **blocks;
+    uint32_t nblocks;
+};
+
+struct CALL_SITE {
+    const char *function;
+    void *caller;
+    uint32_t calls;
+    size_t maxsize;
+};
+
+struct TREE_SIZE {
+    void **rootp;
+    size_t count;
+};
+
+enum {
+    MODE_UNKNOWN,
+    MODE_NATIVE,
+    MODE_ORIGINAL,
+    MODE_REPORT,
+};
+
+static int mode;
+
+static struct HTABLE *htable;
+
+static struct CALL_SITE call_sites[MAX_CALL_SITES];
+static struct TREE_SIZE tree_sizes[MAX_TREES];
+
+static int compare_call_sites(const void *a, const void *b)
+{
+    const struct CALL_SITE *x = a, *y = b;
+
+    return x->calls < y->calls ? 1 : x->calls > y->calls ? -1 : 0;
+}
+
+static void print_search_report()
+{
+    qsort(call_sites, MAX_CALL_SITES, sizeof *call_sites, compare_call_sites);
+
+    fprintf(stderr, "%-10s %-10s %10s %10s\n", "function", "caller", "calls", "max size");
+
+    for (int i = 0; i < MAX_CALL_SITES && call_sites[i].calls; i++) {
+        fprintf(stderr, "%-10s %-10p %10u %10zu\n",
+                        call_sites[i].function,
+                        call_sites[i].caller,
+                        call_sites[i].calls,
+                        call_sites[i].maxsize);
+    }
+}
+
+static void configure_search()
+{
+    const char *setting = getenv("LOTUS_SEARCH");
+
+    mode = MODE_NATIVE;
+
+    if (setting && strcmp(setting, "off") == 0) {
+        mode = MODE_ORIGINAL;
+    }
+
+    if (setting && strcmp(setting, "report") == 0) {
+        mode = MODE_REPORT;
+        atexit(print_search_report);
+    }
+}
+
+static int get_mode()
+{
+    if (mode == MODE_UNKNOWN) {
+        configure_search();
+    }
+
+    return mode;
+}
+
+// Count a call from caller, when the structure is size elements.
+static void count_call(const char *function, void *caller, size_t size)
+{
+    uint32_t i = ((uintptr_t) caller >> 2) % MAX_CALL_SITES;
+
+    if (get_mode() != MODE_REPORT)
+        return;
+
+    for (uint32_t probes = 0; probes < MAX_CALL_SITES; probes++) {
+        struct CALL_SITE *site = &call_sites[i];
+
+        if (site->calls == 0) {
+            site->function = function;
+            site->caller = caller;
+        }
+
+        if (site->caller == caller && site->function == function) {
+            site->calls++;
+            site->maxsize = MAX(site->maxsize, size);
+            return;
+        }
+
+        i = (i + 1) % MAX_CALL_SITES;
+    }
+}
+
+// Track the number of nodes in a tree by its root pointer.
+static size_t *tree_size(void **rootp)
+{
+    uint32_t i = ((uintptr_t) rootp >> 2) % MAX_TREES;
+
+    if (get_mode() != MODE_REPORT || rootp == NULL)
+        return NULL;
+
+    for (uint32_t probes = 0; probes < MAX_TREES; probes++) {
+        struct TREE_SIZE *tree = &tree_sizes[i];
+
+        if (tree->rootp == NULL) {
+            tree->rootp = rootp;
+        }
+
+        if (tree->rootp == rootp) {
+            return &tree->count;
+        }
+
+        i = (i + 1) % MAX_TREES;
+    }
+
+    return NULL;
+}
+
+static uint32_t hash_key(const char *key)
+{
+    uint32_t hash = 2166136261;
+
+    while (*key) {
+        hash ^= (uint8_t) *key++;
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+static ENTRY *get_entry(const struct HTABLE *table, uint32_t n)
+{
+    return &table->blocks[n / BLOCK_ENTRIES][n % BLOCK_ENTRIES];
+}
+
+// Find the slot for a key, either the one it's in or the empty one it should
+// go in.
+static uint32_t find_slot(const struct HTABLE *table, const char *key, uint32_t hash)
+{
+    uint32_t i = hash & (table->nslots - 1);
+
+    while (table->slots[i]) {
+        if (table->hashes[i] == hash && strcmp(get_entry(table, table->slots[i] - 1)->key, key) == 0)
+            break;
+
+        i = (i + 1) & (table->nslots - 1);
+    }
+
+    return i;
+}
+
+static bool alloc_slots(struct HTABLE *table, uint32_t nslots)
+{
+    table->nslots = nslots;
+    table->slots = calloc(nslots, sizeof *table->slots);
+    table->hashes = calloc(nslots, sizeof *table->hashes);
+
+    return table->slots && table->hashes;
+}
+
+// Double the number of slots, the entries stay where they are.
+static bool grow_table(struct HTABLE *table)
+{
+    struct HTABLE old = *table;
+
+    if (!alloc_slots(table, old.nslots * 2)) {
+        free(table->slots);
+        free(table->hashes);
+        *table = old;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < old.nslots; i++) {
+        if (old.slots[i]) {
+            uint32_t slot = old.hashes[i] & (table->nslots - 1);
+
+            while (table->slots[slot])
+                slot = (slot + 1) & (table->nslots - 1);
+
+            table->slots[slot] = old.slots[i];
+            table->hashes[slot] = old.hashes[i];
+        }
+    }
+
+    free(old.slots);
+    free(old.hashes);
+    return true;
+}
+
+static ENTRY *native_hsearch(ENTRY item, ACTION action)
+{
+    uint32_t hash, slot;
+    ENTRY *entry;
+
+    if (htable == NULL)
+        return NULL;
+
+    hash = hash_key(item.key);
+    slot = find_slot(htable, item.key, hash);
+
+    if (htable->slots[slot])
+        return get_entry(htable, htable->slots[slot] - 1);
+
+    if (action == FIND)
+        return NULL;
+
+    // Keep the table no more than half full.
+    if ((htable->count + 1) * 2 > htable->nslots) {
+        if (!grow_table(htable))
+            return NULL;
+
+        slot = find_slot(htable, item.key, hash);
+    }
+
+    if (htable->count == htable->nblocks * BLOCK_ENTRIES) {
+        ENTRY **blocks = realloc(htable->blocks, (htable->nblocks + 1) * sizeof *blocks);
+
+        if (blocks == NULL)
+            return NULL;
+
+        htable->blocks = blocks;
+
+        if ((htable->blocks[htable->nblocks] = malloc(BLOCK_ENTRIES * sizeof(ENTRY))) == NULL)
+            return NULL;
+
+        htable->nblocks++;
+    }
+
+    entry = get_entry(htable, htable->count);
+    *entry = item;
+
+    htable->slots[slot] = ++htable->count;
+    htable->hashes[slot] = hash;
+    return entry;
+}
+
+static int native_hcreate(size_t nel)
+{
+    uint32_t nslots = MIN_SLOTS;
+
+    // Glibc doesn't allow a second table either.
+    if (htable != NULL)
+        return 0;
+
+    while (nslots < nel * 2 && nslots < UINT32_MAX / 2 + 1)
+        nslots *= 2;
+
+    if ((htable = calloc(1, sizeof *htable)) == NULL)
+        return 0;
+
+    if (!alloc_slots(htable, nslots)) {
+        free(htable->slots);
+        free(htable->hashes);
+        free(htable);
+        htable = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+// The keys belong to the caller, like glibc.
+static void native_hdestroy()
+{
+    if (htable == NULL)
+        return;
+
+    for (uint32_t i = 0; i < htable->nblocks; i++) {
+        free(htable->blocks[i]);
+    }
+
+    free(htable->blocks);
+    free(htable->slots);
+    free(htable->hashes);
+    free(htable);
+
+    htable = NULL;
+}
+
+int __unix_hcreate(size_t nel)
+{
+    count_call("hcreate", __builtin_return_address(0), nel);
+
+    return get_mode() == MODE_ORIGINAL ? hcreate(nel) : native_hcreate(nel);
+}
+
+void __unix_hdestroy()
+{
+    count_call("hdestroy", __builtin_return_address(0), htable ? htable->count : 0);
+
+    if (get_mode() == MODE_ORIGINAL) {
+        hdestroy();
+    } else {
+        native_hdestroy();
+    }
+}
+
+ENTRY * __unix_hsearch(ENTRY item, ACTION action)
+{
+    count_call("hsearch", __builtin_return_address(0), htable ? htable->count : 0);
+
+    return get_mode() == MODE_ORIGINAL ? hsearch(item, action) : native_hsearch(item, action);
+}
+
+void * __unix_tsearch(const void *key, void **rootp, int (*compar)(const void *, const void *))
+{
+    size_t *size = tree_size(rootp);
+    void **node = tsearch(key, rootp, compar);
+
+    // A new node has our key pointer, that's the best we can do.
+    if (size && node && *node == key)
+        ++*size;
+
+    count_call("tsearch", __builtin_return_address(0), size ? *size : 0);
+    return node;
+}
+
+void * __unix_tfind(const void *key, void *const *rootp, int (*compar)(const void *, const void *))
+{
+    size_t *size = tree_size((void **) rootp);
+
+    count_call("tfind", __builtin_return_address(0), size ? *size : 0);
+    return tfind(key, rootp, compar);
+}
+
+void * __unix_tdelete(const void *key, void **rootp, int (*compar)(const void *, const void *))
+{
+    size_t *size = tree_size(rootp);
+    void *parent = tdelete(key, rootp, compar);
+
+    if (size && parent && *size)
+        --*size;
+
+    count_call("tdelete", __builtin_return_address(0), size ? *size : 0);
+    return parent;
+}
+
+void __unix_twalk(const void *root, void (*action)(const void *, VISIT, int))
+{
+    count_call("twalk", __builtin_return_address(0), 0);
+    twalk(root, action);
+}
+
+void * __unix_lsearch(const void *key,
+                      void *base,
+                      size_t *nmemb,
+                      size_t size,
+                      int (*compar)(const void *, const void *))
+{
+    count_call("lsearch", __builtin_return_address(0), *nmemb);
+    return lsearch(key, base, nmemb, size, compar);
+}
+
+void * __unix_lfind(const void *key,
+                    const void *base,
+                    size_t *nmemb,
+                    size_t size,
+                    int (*compar)(const void *, const void *))
+{
+    count_call("lfind", __builtin_return_address(0), *nmemb);
+    return lfind(key, base, nmemb, size, compar);
+}
+
+void * __unix_bsearch(const void *key,
+                      const void *base,
+                      size_t nmemb,
+                      size_t size,
+                      int (*compar)(const void *, const void *))
+{
+    count_call("bsearch", __builtin_return_address(0), nmemb);
+    return bsearch(key, base, nmemb, size, compar);
+}
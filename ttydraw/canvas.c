@@ -16,49 +16,72 @@
  *  http://www.wtfpl.net/ for more details.
  */
 
-#include "config.h"
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include "config.h"
 
 #include "ttydraw.h"
 #include "ttyint.h"
 
+// Each canvas owns its own framebuffer, nothing is drawn to the terminal
+// until the canvas is flushed with caca_flush_canvas(). This means any
+// number of canvases can be rendered off-screen at the same time.
 caca_canvas_t * caca_create_canvas(int width, int height)
 {
-    static caca_canvas_t canvas;
-    static struct caca_frame frame;
     caca_canvas_t * cv;
 
-    if (canvas.refcount != 0)
-        return NULL;
-
     if (width < 0 || height < 0) {
         seterrno(EINVAL);
         return NULL;
     }
 
-    cv = &canvas;
-    cv->refcount++;
+    cv = malloc(sizeof *cv);
+
+    if (cv == NULL)
+        goto nomem;
+
     cv->autoinc = 0;
     cv->resize_callback = NULL;
     cv->resize_data = NULL;
 
     cv->frame = 0;
     cv->framecount = 1;
-    cv->frames = &frame;
+    cv->frames = malloc(sizeof *cv->frames);
+
+    if (cv->frames == NULL)
+        goto nomem;
+
     cv->frames[0].width = width;
     cv->frames[0].height = height;
+    cv->frames[0].chars = malloc(width * height * sizeof(uint32_t));
+    cv->frames[0].attrs = malloc(width * height * sizeof(uint32_t));
     cv->frames[0].x = cv->frames[0].y = 0;
     cv->frames[0].handlex = cv->frames[0].handley = 0;
     cv->frames[0].curattr = 0;
     cv->frames[0].name = "frame#00000000";
 
+    if (width && height && (!cv->frames[0].chars || !cv->frames[0].attrs))
+        goto nomem;
+
     _caca_load_frame_info(cv);
 
     cv->ndirty = 0;
-    cv->dirty_disabled = 1;
+    cv->dirty_disabled = 0;
     cv->ff = NULL;
+
+    caca_clear_canvas(cv);
     return cv;
+
+nomem:
+    if (cv && cv->frames) {
+        free(cv->frames[0].chars);
+        free(cv->frames[0].attrs);
+        free(cv->frames);
+    }
+    free(cv);
+    seterrno(ENOMEM);
+    return NULL;
 }
 
 int caca_get_canvas_width(caca_canvas_t const *cv)
@@ -71,9 +94,24 @@ int caca_get_canvas_height(caca_canvas_t const *cv)
     return cv->height;
 }
 
+uint32_t const * caca_get_canvas_chars(caca_canvas_t const *cv)
+{
+    return cv->chars;
+}
+
+uint32_t const * caca_get_canvas_attrs(caca_canvas_t const *cv)
+{
+    return cv->attrs;
+}
+
 int caca_free_canvas(caca_canvas_t *cv)
 {
-    cv->refcount--;
+    if (cv == NULL)
+        return 0;
+
+    free(cv->frames[0].chars);
+    free(cv->frames[0].attrs);
+    free(cv->frames);
+    free(cv);
     return 0;
 }
-
@@ -0,0 +1,97 @@
+/*
+ *  libcaca     Colour ASCII-Art library
+ *  Copyright © 2002—2018 Sam Hocevar <sam@hocevar.net>
+ *              All Rights Reserved
+ *
+ *  This library is free software. It comes without any warranty, to
+ *  the extent permitted by applicable law. You can redistribute it
+ *  and/or modify it under the terms of the Do What the Fuck You Want
+ *  to Public License, Version 2, as published by Sam Hocevar. See
+ *  http://www.wtfpl.net/ for more details.
+ */
+
+/*
+ *  This file contains the dirty rectangle management functions.
+ *
+ *  Unlike libcaca, ttydraw only tracks a single bounding rectangle. Graphs
+ *  are drawn a primitive at a time and flushed often, so merging is cheap
+ *  and good enough.
+ */
+
+#include "config.h"
+#include "ttydraw.h"
+#include "ttyint.h"
+
+int caca_disable_dirty_rect(caca_canvas_t *cv)
+{
+    cv->dirty_disabled++;
+    return 0;
+}
+
+int caca_enable_dirty_rect(caca_canvas_t *cv)
+{
+    if (cv->dirty_disabled <= 0) {
+        seterrno(EINVAL);
+        return -1;
+    }
+
+    cv->dirty_disabled--;
+    return 0;
+}
+
+int caca_get_dirty_rect_count(caca_canvas_t *cv)
+{
+    return cv->ndirty;
+}
+
+int caca_get_dirty_rect(caca_canvas_t *cv, int r,
+                        int *x, int *y, int *width, int *height)
+{
+    if (r < 0 || r >= cv->ndirty) {
+        seterrno(EINVAL);
+        return -1;
+    }
+
+    *x = cv->dirty[r].xmin;
+    *y = cv->dirty[r].ymin;
+    *width = cv->dirty[r].xmax - cv->dirty[r].xmin + 1;
+    *height = cv->dirty[r].ymax - cv->dirty[r].ymin + 1;
+    return 0;
+}
+
+int caca_add_dirty_rect(caca_canvas_t *cv, int x, int y, int width, int height)
+{
+    int xmax = x + width - 1;
+    int ymax = y + height - 1;
+
+    // Clip to the canvas.
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (xmax >= cv->width) xmax = cv->width - 1;
+    if (ymax >= cv->height) ymax = cv->height - 1;
+
+    if (x > xmax || y > ymax)
+        return 0;
+
+    if (cv->ndirty == 0) {
+        cv->ndirty = 1;
+        cv->dirty[0].xmin = x;
+        cv->dirty[0].ymin = y;
+        cv->dirty[0].xmax = xmax;
+        cv->dirty[0].ymax = ymax;
+        return 0;
+    }
+
+    // Grow the existing rectangle to include the new one.
+    if (x < cv->dirty[0].xmin) cv->dirty[0].xmin = x;
+    if (y < cv->dirty[0].ymin) cv->dirty[0].ymin = y;
+    if (xmax > cv->dirty[0].xmax) cv->dirty[0].xmax = xmax;
+    if (ymax > cv->dirty[0].ymax) cv->dirty[0].ymax = ymax;
+    return 0;
+}
+
+int caca_clear_dirty_rect_list(caca_canvas_t *cv)
+{
+    cv->ndirty = 0;
+    return 0;
+}
@@ -15,7 +15,10 @@ int main(int argc, char *argv[])
     caca_draw_thin_line(cv, 10, 10, 80, 25);
     caca_draw_cp437_box(cv, 20, 5, 20, 10);
     caca_fill_ellipse(cv, 80, 8, 5, 5, '#');
+    caca_flush_canvas(cv, 0, 0);
+    refresh();
     getch();
+    caca_free_canvas(cv);
     endwin();
     return 0;
 }
@@ -59,6 +59,8 @@ void _caca_save_frame_info(caca_canvas_t *cv)
 {
     cv->frames[cv->frame].width = cv->width;
     cv->frames[cv->frame].height = cv->height;
+    cv->frames[cv->frame].chars = cv->chars;
+    cv->frames[cv->frame].attrs = cv->attrs;
     cv->frames[cv->frame].curattr = cv->curattr;
 }
 
@@ -66,6 +68,8 @@ void _caca_load_frame_info(caca_canvas_t *cv)
 {
     cv->width = cv->frames[cv->frame].width;
     cv->height = cv->frames[cv->frame].height;
+    cv->chars = cv->frames[cv->frame].chars;
+    cv->attrs = cv->frames[cv->frame].attrs;
     cv->curattr = cv->frames[cv->frame].curattr;
 }
 
@@ -0,0 +1,64 @@
+//
+// This file is not part of libcaca, it copies a ttydraw canvas to the curses
+// screen.
+//
+
+#include <stddef.h>
+#include <curses.h>
+#include "config.h"
+
+#include "ttydraw.h"
+#include "ttyint.h"
+
+// Copy any cells that have changed since the last flush to the curses screen
+// at (x, y). The caller is responsible for calling refresh().
+int caca_flush_canvas(caca_canvas_t *cv, int x, int y)
+{
+    int dx, dy, width, height;
+
+    if (caca_get_dirty_rect(cv, 0, &dx, &dy, &width, &height) != 0)
+        return 0;
+
+    for (int j = dy; j < dy + height; j++) {
+        for (int i = dx; i < dx + width; i++) {
+            uint32_t ch = cv->chars[i + j * cv->width];
+            uint32_t attr = cv->attrs[i + j * cv->width];
+            mvaddch(y + j, x + i, ch | COLOR_PAIR(attr));
+        }
+    }
+
+    caca_clear_dirty_rect_list(cv);
+    return 0;
+}
+
+// prev is what's on the curses screen in the area at (x, y) that is the
+// same size as prev. Copy the cells of cv in that area that differ from prev
+// to the screen, then update prev to match. This is used to redraw a graph
+// that is always on screen, so that only the parts that moved are written,
+// and nothing outside the graph is touched.
+int caca_flush_canvas_changes(caca_canvas_t *cv, caca_canvas_t *prev, int x, int y)
+{
+    if (x < 0 || y < 0 || x + prev->width > cv->width || y + prev->height > cv->height) {
+        seterrno(EINVAL);
+        return -1;
+    }
+
+    for (int j = 0; j < prev->height; j++) {
+        for (int i = 0; i < prev->width; i++) {
+            int n = (y + j) * cv->width + x + i;
+            int p = j * prev->width + i;
+
+            if (cv->chars[n] == prev->chars[p] && cv->attrs[n] == prev->attrs[p])
+                continue;
+
+            mvaddch(y + j, x + i, cv->chars[n] | COLOR_PAIR(cv->attrs[n]));
+
+            prev->chars[p] = cv->chars[n];
+            prev->attrs[p] = cv->attrs[n];
+        }
+    }
+
+    caca_clear_dirty_rect_list(cv);
+    caca_clear_dirty_rect_list(prev);
+    return 0;
+}
@@ -3,7 +3,6 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <curses.h>
 #include "config.h"
 
 #include "ttydraw.h"
@@ -11,10 +10,42 @@
 
 int caca_put_char(caca_canvas_t *cv, int x, int y, uint32_t ch)
 {
-    mvaddch(y, x, ch | COLOR_PAIR(cv->curattr));
+    if (x < 0 || y < 0 || x >= (int)cv->width || y >= (int)cv->height) {
+        return 1;
+    }
+
+    cv->chars[x + y * cv->width] = ch;
+    cv->attrs[x + y * cv->width] = cv->curattr;
+
+    if (!cv->dirty_disabled)
+        caca_add_dirty_rect(cv, x, y, 1, 1);
+
     return 1;
 }
 
+uint32_t caca_get_char(caca_canvas_t const *cv, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= (int)cv->width || y >= (int)cv->height) {
+        return ' ';
+    }
+
+    return cv->chars[x + y * cv->width];
+}
+
+int caca_put_attr(caca_canvas_t *cv, int x, int y, uint32_t attr)
+{
+    if (x < 0 || y < 0 || x >= (int)cv->width || y >= (int)cv->height) {
+        return 0;
+    }
+
+    cv->attrs[x + y * cv->width] = attr;
+
+    if (!cv->dirty_disabled)
+        caca_add_dirty_rect(cv, x, y, 1, 1);
+
+    return 0;
+}
+
 int caca_put_str(caca_canvas_t *cv, int x, int y, char const *s)
 {
     int len;
@@ -29,3 +60,55 @@ int caca_put_str(caca_canvas_t *cv, int x, int y, char const *s)
     return len;
 }
 
+
+int caca_clear_canvas(caca_canvas_t *cv)
+{
+    for (int n = 0; n < cv->width * cv->height; n++) {
+        cv->chars[n] = ' ';
+        cv->attrs[n] = cv->curattr;
+    }
+
+    // Nothing has been drawn yet, so there is nothing to flush.
+    caca_clear_dirty_rect_list(cv);
+    return 0;
+}
+
+// Copy src onto dst at (x, y). If a mask is specified, only cells where the
+// mask is not blank are copied.
+int caca_blit(caca_canvas_t *dst, int x, int y,
+              caca_canvas_t const *src, caca_canvas_t const *mask)
+{
+    int i, j, starti, startj, endi, endj;
+
+    if (mask && (src->width != mask->width || src->height != mask->height)) {
+        seterrno(EINVAL);
+        return -1;
+    }
+
+    starti = x < 0 ? -x : 0;
+    startj = y < 0 ? -y : 0;
+    endi = (x + src->width >= dst->width) ? dst->width - x : src->width;
+    endj = (y + src->height >= dst->height) ? dst->height - y : src->height;
+
+    if (starti >= endi || startj >= endj)
+        return 0;
+
+    for (j = startj; j < endj; j++) {
+        int dstix = (j + y) * dst->width + starti + x;
+        int srcix = j * src->width + starti;
+
+        for (i = starti; i < endi; i++, dstix++, srcix++) {
+            if (mask && mask->chars[srcix] == (uint32_t)' ')
+                continue;
+
+            dst->chars[dstix] = src->chars[srcix];
+            dst->attrs[dstix] = src->attrs[srcix];
+        }
+    }
+
+    if (!dst->dirty_disabled)
+        caca_add_dirty_rect(dst, starti + x, startj + y,
+                            endi - starti, endj - startj);
+
+    return 0;
+}
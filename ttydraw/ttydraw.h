@@ -272,7 +272,6 @@ __extern int caca_get_dirty_rect_count(caca_canvas_t *);
 __extern int caca_get_dirty_rect(caca_canvas_t *, int, int *, int *,
                                  int *, int *);
 __extern int caca_add_dirty_rect(caca_canvas_t *, int, int, int, int);
-__extern int caca_remove_dirty_rect(caca_canvas_t *, int, int, int, int);
 __extern int caca_clear_dirty_rect_list(caca_canvas_t *);
 /*  @} */
 
@@ -671,6 +670,17 @@ __extern int    caca_conio_wherey(void);
 __extern void   caca_conio_window(int left, int top, int right, int bottom);
 /*  @} */
 
+/** \defgroup ttydraw ttydraw curses output
+ *
+ *  These functions are specific to ttydraw, they copy a canvas to the
+ *  curses screen.
+ *
+ *  @{ */
+__extern int caca_flush_canvas(caca_canvas_t *, int, int);
+__extern int caca_flush_canvas_changes(caca_canvas_t *, caca_canvas_t *,
+                                      int, int);
+/*  @} */
+
 #if !defined(_DOXYGEN_SKIP_ME)
     /* Legacy stuff from beta versions, will probably disappear in 1.0 */
 
@@ -30,6 +30,8 @@ struct caca_frame
 {
     /* Frame size */
     int width, height;
+    uint32_t *chars;
+    uint32_t *attrs;
 
     /* Painting context */
     int x, y;
@@ -50,7 +52,6 @@ struct caca_canvas
     struct caca_frame *frames;
 
     /* Canvas management */
-    int refcount;
     int autoinc;
     int (*resize_callback)(void *);
     void *resize_data;
@@ -65,6 +66,8 @@ struct caca_canvas
 
     /* Shortcut to the active frame information */
     int width, height;
+    uint32_t *chars;
+    uint32_t *attrs;
     uint32_t curattr;
 
     /* FIGfont management */
@@ -21,6 +21,8 @@
 
 #include "unixterm.h"
 #include "filemap.h"
+#include "profile.h"
+#include "graphics.h"
 
 // The Lotus view of errno.
 extern int __unix_errno;
@@ -384,6 +386,9 @@ int __unix_read(int fd, void *buf, size_t count)
     if (fd == STDIN_FILENO && count == 1 && isatty(fd)) {
         char key;
 
+        // Print a profile report if one was requested.
+        profile_poll();
+
         // Do the actual read.
         result = read(fd, &key, 1);
 
@@ -417,6 +422,24 @@ int __unix_read(int fd, void *buf, size_t count)
     return result;
 }
 
+int __unix_write(int fd, const void *buf, size_t count)
+{
+    int result = write(fd, buf, count);
+
+    if (result < 0) {
+        __unix_errno = errno;
+        return result;
+    }
+
+    // Lotus draws the worksheet itself, keep a copy so that it can be put
+    // back after a graph.
+    if (fd == STDOUT_FILENO) {
+        save_text_output(buf, result);
+    }
+
+    return result;
+}
+
 int __unix_sysi86(int cmd, uint32_t *result)
 {
     // This is used to check for x87 support, nothing else is supported.